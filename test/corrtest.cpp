@@ -4,14 +4,19 @@
 #include <iostream>
 #include <ostream>
 #include <filesystem>
+#include <set>
+#include <sstream>
+#include <vector>
 using namespace std;
 
 float readmidTH2();
 float readmaxTH2();
 
 float readTGV(int k, string file);
-//float readHighSpeed();
-//float v = readHighSpeed();
+float readHighSpeed(string file);
+//float v = readHighSpeed("1Ddetonation/fieldMinMax.dat");
+float vImplicit = readHighSpeed("1Ddetonation/implicit/fieldMinMax.dat");
+float vExplicit = readHighSpeed("1Ddetonation/explicit/fieldMinMax.dat");
 
 float H2maxT = readmaxTH2();
 float H2midT = readmidTH2();
@@ -23,6 +28,14 @@ float TGV200 = readTGV(1064,"2DTGV/2/data_T.xy");
 float TGV300 = readTGV(1064,"2DTGV/3/data_T.xy");
 float TGV400 = readTGV(1098,"2DTGV/4/data_T.xy");
 
+vector<float> readProfile(string file);
+vector<float> TGVProfile = readProfile("2DTGV/1/data_T.xy");
+vector<float> TGVFluxCacheProfile = readProfile("2DTGV/fluxCache/data_T.xy");
+
+
+vector<long> readLabelList(string file);
+vector<long> sprayIds = readLabelList("sprayBreakup/origId");
+
 
 float readSandia(int k, string file);
 float T1 = readSandia(1,"2DSandia/data_T.xy");
@@ -49,10 +62,26 @@ TEST(corrtest,dfLowMachFoam_TGV){
     EXPECT_FLOAT_EQ(TGV100,364.018);
 }
 
+TEST(corrtest,dfLowMachFoam_TGV_diffusionFluxCache){
+    // the cached fluxes are the same operations, the profiles must be equal
+    ASSERT_GT(TGVProfile.size(), 0u);
+    ASSERT_EQ(TGVFluxCacheProfile.size(), TGVProfile.size());
+    for (size_t i = 0; i < TGVProfile.size(); i++){
+        EXPECT_FLOAT_EQ(TGVFluxCacheProfile[i], TGVProfile[i]);   // temperature along y after 100 time steps
+    }
+}
+
 //TEST(corrtest,dfHighSpeedFoam){
 //    EXPECT_NEAR(v,1979.33,19.79); // within 1% of the theroetical value
 //}
 
+TEST(corrtest,dfHighSpeedFoam_explicitSpecies){
+    // the explicit species advance differs from the implicit one by the
+    // truncation errors of the schemes, the detonation speeds agree within 1%
+    EXPECT_GT(vImplicit, 0);
+    EXPECT_NEAR(vExplicit,vImplicit,0.01*vImplicit);
+}
+
 TEST(corrtest,2DSandia){
     EXPECT_FLOAT_EQ(T1,762.5418507);   
     EXPECT_FLOAT_EQ(T2,1155.163112);  
@@ -63,6 +92,13 @@ TEST(corrtest,2DSandia){
     
 }
 
+TEST(corrtest,dfSprayFoam_breakupIds){
+    // the serial run has one processor, so the parcel IDs alone must differ
+    set<long> uniqueIds(sprayIds.begin(), sprayIds.end());
+    EXPECT_GT(sprayIds.size(), 0u);
+    EXPECT_EQ(uniqueIds.size(), sprayIds.size()); // the breakup children have new IDs
+}
+
 float readmaxTH2(){
     float a;
     string inFileName = "0DH2/T" ;
@@ -144,7 +180,7 @@ float readTGV(int k, string file){
 }
 
 
-float readHighSpeed(){
+float readHighSpeed(string file){
     float xsum=0,x2sum=0,ysum=0,xysum=0;
     float t;
     char dummy;
@@ -160,7 +196,7 @@ float readHighSpeed(){
     int i = 0;
     float slope2;
 
-    string inFileName = "1Ddetonation/fieldMinMax.dat" ;
+    string inFileName = file;
     ifstream inFile;
     inFile.open(inFileName.c_str());
 
@@ -218,3 +254,64 @@ float readSandia(int k, string file){
 
     return b;
 }
+
+
+
+
+vector<float> readProfile(string file){
+
+    vector<float> values;
+    float x,T;
+
+    string inFileName = file;
+    ifstream inFile;
+    inFile.open(inFileName.c_str());
+
+    if (inFile.is_open())
+    {
+        while (inFile >> x >> T){
+            values.push_back(T);
+        }
+    }
+    else { //Error message
+        cerr << "Can't find input file " << inFileName << endl;
+    }
+
+    return values;
+}
+
+
+
+
+vector<long> readLabelList(string file){
+
+    vector<long> values;
+
+    string inFileName = file;
+    ifstream inFile;
+    inFile.open(inFileName.c_str());
+
+    if (inFile.is_open())
+    {
+        stringstream buffer;
+        buffer << inFile.rdbuf();
+        string text = buffer.str();
+
+        // the list follows the FoamFile header: N ( v0 v1 ... )
+        size_t start = text.find("// * * *");
+        start = text.find('(', start == string::npos ? 0 : start);
+        size_t end = text.find(')', start);
+        if (start != string::npos && end != string::npos){
+            istringstream list(text.substr(start + 1, end - start - 1));
+            long a;
+            while (list >> a){
+                values.push_back(a);
+            }
+        }
+    }
+    else { //Error message
+        cerr << "Can't find input file " << inFileName << endl;
+    }
+
+    return values;
+}